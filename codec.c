@@ -0,0 +1,152 @@
+/*-
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2025 David Marker
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <err.h>
+#include <string.h>
+
+#include "jep.h"
+
+/*
+ * MAC addresses, interface and group names are parsed and checked once, here, so the
+ * if_* routines can just copy them into their ioctl requests. Nothing in this
+ * file allocates or calls into stdio, it is all table lookups and fixed size
+ * buffers.
+ */
+
+/* hex digit value + 1 so anything not listed (0) is not hex */
+static const uint8_t hexval[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+static const char hexdig[] = "0123456789abcdef";
+
+/*
+ * Accepts 6 octets of 1 or 2 hex digits (either case) separated by all ':' or
+ * all '-', so both ifconfig(8) and the usual Windows style work. Multicast
+ * (which includes broadcast) and all zero addresses can't be assigned to an
+ * interface so are rejected as well. Returns 0 or -1 with errno EINVAL.
+ */
+int
+mac_parse(const char *str, uint8_t mac[ETHER_ADDR_LEN])
+{
+	int i, n, v, sep = '\0';
+	const unsigned char *cp = (const unsigned char *)str;
+	uint8_t any = 0;
+
+	assert(str != NULL && mac != NULL);
+	for (i = 0; i < ETHER_ADDR_LEN; i++) {
+		if (i > 0) {
+			/* also stops at the NUL of a short string */
+			if (*cp != ':' && *cp != '-')
+				goto bad;
+			if (sep == '\0')
+				sep = *cp;
+			if (*cp++ != sep)
+				goto bad;
+		}
+		for (v = 0, n = 0; n < 2 && hexval[*cp] != 0; n++)
+			v = (v << 4) | (hexval[*cp++] - 1);
+		if (n == 0)
+			goto bad;
+		mac[i] = v;
+		any |= v;
+	}
+	if (*cp != '\0' || (mac[0] & 0x01) || any == 0)
+		goto bad;
+	return (0);
+bad:
+	errno = EINVAL;
+	return (-1);
+}
+
+/* lower-case hex separated by ':', same as ifconfig(8) prints */
+char *
+mac_format(const uint8_t mac[ETHER_ADDR_LEN], char str[LLNAMSIZ])
+{
+	int i;
+	char *cp = str;
+
+	assert(mac != NULL && str != NULL);
+	for (i = 0; i < ETHER_ADDR_LEN; i++) {
+		if (i > 0)
+			*cp++ = ':';
+		*cp++ = hexdig[mac[i] >> 4];
+		*cp++ = hexdig[mac[i] & 0x0f];
+	}
+	*cp = '\0';
+	assert(cp - str == LLNAMLEN);
+	return (str);
+}
+
+/*
+ * The one place an interface name is checked. Warns and returns -1 with errno
+ * EINVAL if `str` is empty or too long, otherwise `ifn` is set.
+ */
+int
+ifname_set(ifname_t *ifn, const char *str)
+{
+	size_t len;
+
+	assert(ifn != NULL && str != NULL);
+	if ((len = strnlen(str, IFNAMSIZ)) == 0 || len == IFNAMSIZ) {
+		warnc(EINVAL, "ifname=\"%.*s\" %s", IFNAMSIZ, str,
+		    len ? "too long" : "empty");
+		errno = EINVAL;
+		return (-1);
+	}
+	memcpy(ifn->name, str, len);
+	memset(ifn->name + len, '\0', IFNAMSIZ - len);
+	return (0);
+}
+
+/*
+ * Group names share the interface name space, the kernel refuses one ending
+ * in a digit (it would be ambiguous with interface names) so check that here
+ * to give a better message than EINVAL from the ioctl. Warns and returns -1
+ * with errno EINVAL if `group` can't be used.
+ */
+int
+ifgroup_check(const char *group)
+{
+	int rc = 0;
+	size_t len;
+
+	assert(group != NULL);
+	if ((len = strlen(group)) >= IFNAMSIZ) warnc(
+		EINVAL, "group=\"%s\" too long", group
+	), rc++;
+	if (len == 0 || isdigit((unsigned char)group[len - 1])) warnc(
+		EINVAL, "group=\"%s\" must not be empty or end in a digit", group
+	), rc++;
+	if (rc) {
+		errno = EINVAL;
+		return (-1);
+	}
+	return (0);
+}
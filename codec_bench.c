@@ -0,0 +1,159 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 David Marker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlfcn.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "jep.h"
+
+/*
+ * Microbenchmark for codec.c, `make bench`. Prints the cost per call of each
+ * routine and fails if any of them touched the heap while being timed, which
+ * is the whole point of them. Allocations are counted by interposing the
+ * malloc(3) family, the real ones are found with dlsym(3) RTLD_NEXT.
+ */
+
+#define	BENCH_N		10000000
+
+static unsigned long	nalloc;		/* heap calls while counting */
+static int		counting;
+
+static void *
+realfn(const char *name)
+{
+	void *fn;
+
+	if ((fn = dlsym(RTLD_NEXT, name)) == NULL)
+		abort(); /* nothing sane left to do from inside malloc */
+	return (fn);
+}
+
+void *
+malloc(size_t size)
+{
+	static void *(*real)(size_t);
+
+	if (real == NULL)
+		real = realfn("malloc");
+	nalloc += counting;
+	return (real(size));
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+	static void *(*real)(size_t, size_t);
+
+	if (real == NULL)
+		real = realfn("calloc");
+	nalloc += counting;
+	return (real(n, size));
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	static void *(*real)(void *, size_t);
+
+	if (real == NULL)
+		real = realfn("realloc");
+	nalloc += counting;
+	return (real(ptr, size));
+}
+
+static double
+nsnow(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/* keeps the compiler from dropping the calls being timed */
+static volatile unsigned int sink;
+
+static int
+report(const char *what, double start)
+{
+	double ns = (nsnow() - start) / BENCH_N;
+
+	counting = 0;
+	(void) printf("%-12s %8.1f ns/call %lu allocations\n", what, ns,
+	    nalloc);
+	return (nalloc != 0);
+}
+
+int
+main(void)
+{
+	int i, rc = 0;
+	double start;
+	uint8_t mac[ETHER_ADDR_LEN] = { 0x02, 0x15, 0x5d, 0x01, 0x11, 0x31 };
+	char buf[LLNAMSIZ];
+	ifname_t ifn;
+	static const char *macs[] = {
+		"02:15:5d:01:11:31", "02-15-5D-01-11-31", "2:0:0:0:0:1",
+	};
+	static const char *names[] = {
+		"jail0test", "lan0", "epair123456789a",
+	};
+
+	nalloc = 0;
+	counting = 1;
+	start = nsnow();
+	for (i = 0; i < BENCH_N; i++) {
+		if (mac_parse(macs[i % nitems(macs)], mac) != 0)
+			errx(1, "mac_parse(%s)", macs[i % nitems(macs)]);
+		sink += mac[5];
+	}
+	rc |= report("mac_parse", start);
+
+	nalloc = 0;
+	counting = 1;
+	start = nsnow();
+	for (i = 0; i < BENCH_N; i++) {
+		mac[5] = i;
+		sink += mac_format(mac, buf)[16];
+	}
+	rc |= report("mac_format", start);
+
+	nalloc = 0;
+	counting = 1;
+	start = nsnow();
+	for (i = 0; i < BENCH_N; i++) {
+		if (ifname_set(&ifn, names[i % nitems(names)]) != 0)
+			errx(1, "ifname_set(%s)", names[i % nitems(names)]);
+		sink += ifn.name[0];
+	}
+	rc |= report("ifname_set", start);
+
+	if (rc)
+		errx(1, "codec touched the heap");
+	return (0);
+}
@@ -0,0 +1,135 @@
+/*-
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 David Marker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jep.h"
+
+/*
+ * libFuzzer harness for codec.c, `make fuzz`. Each input is handed to the
+ * parsers as an exactly sized C string (a copy on the heap so ASan sees any
+ * read past the NUL) and everything they accept has to round trip and keep
+ * the invariants the if_* routines rely on.
+ */
+
+int	LLVMFuzzerInitialize(int *, char ***);
+int	LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+static const char hexdig[] = "0123456789abcdef";
+
+int
+LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	FILE *null;
+
+	(void) argc;
+	(void) argv;
+	/* ifname_set() warns on every bad name, far too noisy here */
+	if ((null = fopen("/dev/null", "w")) == NULL)
+		err(EX_OSERR, "fopen(/dev/null)");
+	err_set_file(null);
+	return (0);
+}
+
+static void
+check_mac(const char *str)
+{
+	int i;
+	uint8_t mac[ETHER_ADDR_LEN], again[ETHER_ADDR_LEN], any = 0;
+	char buf[LLNAMSIZ];
+
+	if (mac_parse(str, mac) != 0) {
+		assert(errno == EINVAL);
+		return;
+	}
+	/* never more than 6 octets of 2 digits and 5 separators */
+	assert(strlen(str) <= LLNAMLEN);
+	for (i = 0; i < ETHER_ADDR_LEN; i++)
+		any |= mac[i];
+	assert(!(mac[0] & 0x01) && any != 0);
+
+	assert(mac_format(mac, buf) == buf);
+	assert(strlen(buf) == LLNAMLEN);
+	for (i = 0; i < LLNAMLEN; i++) {
+		if (i % 3 == 2)
+			assert(buf[i] == ':');
+		else
+			assert(strchr(hexdig, buf[i]) != NULL);
+	}
+	assert(mac_parse(buf, again) == 0);
+	assert(memcmp(mac, again, sizeof(mac)) == 0);
+}
+
+static void
+check_ifname(const char *str)
+{
+	size_t i, len = strlen(str);
+	ifname_t ifn;
+
+	memset(&ifn, 0xa5, sizeof(ifn));
+	if (ifname_set(&ifn, str) != 0) {
+		assert(errno == EINVAL && (len == 0 || len >= IFNAMSIZ));
+		return;
+	}
+	assert(len > 0 && len < IFNAMSIZ);
+	assert(strcmp(ifn.name, str) == 0);
+	for (i = len; i < IFNAMSIZ; i++) /* ioctls copy all of it */
+		assert(ifn.name[i] == '\0');
+}
+
+static void
+check_group(const char *str)
+{
+	size_t len = strlen(str);
+
+	if (ifgroup_check(str) != 0) {
+		assert(errno == EINVAL);
+		return;
+	}
+	assert(len > 0 && len < IFNAMSIZ);
+	assert(!isdigit((unsigned char)str[len - 1]));
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	char *str;
+
+	if ((str = malloc(size + 1)) == NULL)
+		return (0);
+	memcpy(str, data, size);
+	str[size] = '\0';
+
+	check_mac(str);
+	check_ifname(str);
+	check_group(str);
+
+	free(str);
+	return (0);
+}
@@ -24,19 +24,31 @@
 
 #include <assert.h>
 #include <err.h>
-#include <ifaddrs.h>
-#include <net/if_bridgevar.h>
-#include <net/if_dl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <net/bridgestp.h>
+#include <net/if_bridgevar.h>
+#include <net/if_dl.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <netinet/in_var.h>
+#include <netinet6/in6_var.h>
+#include <netinet6/nd6.h>
+#include <arpa/inet.h>
 
 #include "jep.h"
 
 /*
  * This file is just implementing a tiny subset of ifconfig(8), just enough
  * to do everything we need without resorting to system(3).
- * Most of these functions are just assert, runtime check, then ioctl.
+ * Most of these functions are just assert then ioctl, interface names were
+ * already checked once by ifname_set() (codec.c).
  */
 
 
@@ -50,8 +62,8 @@ if_open_ctx()
 	return sd;
 }
 
-char*
-if_epair_create(ifctx ctx, char result[IFNAMSIZ])
+ifname_t *
+if_epair_create(ifctx ctx, ifname_t *result)
 {
 	struct ifreq ifr = { .ifr_name = "epair" };
 
@@ -62,27 +74,19 @@ if_epair_create(ifctx ctx, char result[IFNAMSIZ])
 		warn("%s: ioctl(...SIOCIFCREATE2...)", __func__);
 		return (NULL);
 	}
-	strlcpy(result, ifr.ifr_name, IFNAMSIZ);
+	memcpy(result->name, ifr.ifr_name, sizeof(result->name));
 	return (result);
 }
 
 int
-if_epair_destroy(ifctx ctx, const char *ifname)
+if_epair_destroy(ifctx ctx, const ifname_t *ifname)
 {
 	int rc = 0;
 	struct ifreq ifr = {0};
 
 	assert(ctx >= 0);
 	assert(ifname != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (-1);
-	}
-
-	strlcpy(ifr.ifr_name, ifname, IFNAMSIZ);
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
 	if ((rc = ioctl(ctx, SIOCIFDESTROY, &ifr)) != 0) warn(
 		"%s: ioctl(...SIOCIFDESTROY...)", __func__
 	);
@@ -91,7 +95,7 @@ if_epair_destroy(ifctx ctx, const char *ifname)
 
 /* This is a PULL operation! It uses SIOCSIFRVNET not SIOCSIFVNET */
 int
-if_vmove(ifctx ctx, const char *ifname, int jid)
+if_vmove(ifctx ctx, const ifname_t *ifname, int jid)
 {
 	int rc = 0;
 	struct ifreq ifr = {
@@ -99,15 +103,7 @@ if_vmove(ifctx ctx, const char *ifname, int jid)
 	};
 
 	assert(ifname != NULL && jid >= 0);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (-1);
-	}
-
-	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
 	if ((rc = ioctl(ctx, SIOCSIFRVNET, &ifr)) != 0) warn(
 		"%s: ioctl(...SIOCSIFRVNET...)", __func__
 	);
@@ -115,26 +111,15 @@ if_vmove(ifctx ctx, const char *ifname, int jid)
 }
 
 int
-if_rename(ifctx ctx, const char *ifname, const char *name)
+if_rename(ifctx ctx, const ifname_t *ifname, const ifname_t *name)
 {
 	int rc = 0;
 	struct ifreq ifr = {
-		.ifr_data = (caddr_t)name
+		.ifr_data = (caddr_t)name->name
 	};
 
 	assert(ifname != NULL && name != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (strlen(name) >= IFNAMSIZ) warnc(
-		EINVAL, "name=\"%s\" too long", name
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (-1);
-	}
-
-	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
 	if ((rc = ioctl(ctx, SIOCSIFNAME, &ifr)) != 0) warn(
 		"%s: ioctl(...SIOCSIFNAME...)", __func__
 	);
@@ -142,64 +127,75 @@ if_rename(ifctx ctx, const char *ifname, const char *name)
 }
 
 /*
- * If there is a failure, this function warns and returns NULL.
- * If the MAC for `ifname` is not found `mac` is set to the empty string.
- * But found or not, without error `mac` is returned.
+ * Reads the current MAC of `ifname` into `mac` and, if `epoch` isn't NULL,
+ * the uptime it was attached at. 0 on success otherwise warns and returns -1.
+ *
+ * This used to walk getifaddrs(3) which allocates every address on the
+ * system to find one. Asking the routing sysctl for just this interface's
+ * link address fits in a buffer on the stack.
  */
-char *
-if_getmac(ifctx ctx, const char *ifname, char mac[LLNAMSIZ])
+static int
+getlink(ifctx ctx, const ifname_t *ifname, uint8_t mac[ETHER_ADDR_LEN],
+    intmax_t *epoch)
 {
-	int rc = 0;
-	struct ifaddrs *ifap, *iter;
-	struct sockaddr_dl *sdp;
-	unsigned char *bmac;
+	int mib[6] = { CTL_NET, PF_ROUTE, 0, AF_LINK, NET_RT_IFLIST, 0 };
+	char buf[512];
+	size_t len = sizeof(buf);
+	struct ifreq ifr = {0};
+	struct if_msghdr *ifm = (struct if_msghdr *)buf;
+	struct sockaddr_dl *sdl;
 
+	assert(ctx >= 0);
 	assert(ifname != NULL && mac != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (NULL);
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
+	if (ioctl(ctx, SIOCGIFINDEX, &ifr) != 0) {
+		warn("%s: ioctl(...SIOCGIFINDEX...)", __func__);
+		return (-1);
 	}
+	mib[5] = ifr.ifr_index;
 
-	if (getifaddrs(&ifap) == -1) {
-		warn("%s: getifaddrs(%p)", __func__, &ifap);
-		return (NULL);
+	if (sysctl(mib, nitems(mib), buf, &len, NULL, 0) == -1) {
+		warn("%s: sysctl(NET_RT_IFLIST)", __func__);
+		return (-1);
 	}
-	mac[0] = '\0'; /* in case not found */
-	for (iter = ifap; iter; iter = iter->ifa_next) {
-		/* keep going until we find a mac for ifname */
-		if ((iter->ifa_addr->sa_family != AF_LINK) ||
-		    (strcmp(iter->ifa_name, ifname) != 0))
-			continue;
-
-		sdp = (struct sockaddr_dl*)iter->ifa_addr;
-		bmac = (unsigned char *)LLADDR(sdp);
-		rc = sprintf(
-			mac,
-			"%02x:%02x:%02x:%02x:%02x:%02x",
-			bmac[0], bmac[1], bmac[2], bmac[3], bmac[4], bmac[5]
-		);
-		assert(rc == LLNAMLEN);
-		break;
+	/* first message is RTM_IFINFO with its sockaddr_dl right after */
+	sdl = (struct sockaddr_dl *)(ifm + 1);
+	if (len < sizeof(*ifm) + sizeof(*sdl) || ifm->ifm_type != RTM_IFINFO ||
+	    !(ifm->ifm_addrs & RTA_IFP) || sdl->sdl_alen != ETHER_ADDR_LEN) {
+		warnx("%s: no MAC for \"%s\"", __func__, ifname->name);
+		errno = ENOENT;
+		return (-1);
 	}
-	freeifaddrs(ifap);
+	memcpy(mac, LLADDR(sdl), ETHER_ADDR_LEN);
+	if (epoch != NULL)
+		*epoch = ifm->ifm_data.ifi_epoch;
+	return (0);
+}
 
-	return (mac);
+int
+if_getmac(ifctx ctx, const ifname_t *ifname, uint8_t mac[ETHER_ADDR_LEN])
+{
+	return getlink(ctx, ifname, mac, NULL);
 }
 
 /*
- * mac is normalized to be the same output (lower-case hex separated by ':')
- * that ifconfig(8) returns same as if_getmac returns.
- * 
- * Planning to pipe to another utility...
- *
- * Originally I used link_addr(3) for the mac but really its just easier
- * to scanf(3) and check the right number of conversions occured.
+ * MAC alone doesn't tell an epair from a later one reusing its names, the
+ * MAC may be given on the command line and epair(4) derives its own from the
+ * unit name. The uptime it was attached at does, it never changes while the
+ * interface stays in the same vnet.
  */
-const char *
-if_setmac(ifctx ctx, const char *ifname, char mac[LLNAMSIZ])
+int
+if_getident(ifctx ctx, const ifname_t *ifname, uint8_t mac[ETHER_ADDR_LEN],
+    intmax_t *epoch)
+{
+	assert(epoch != NULL);
+	return getlink(ctx, ifname, mac, epoch);
+}
+
+/* `mac` is expected to have been through mac_parse() already */
+int
+if_setmac(ifctx ctx, const ifname_t *ifname,
+    const uint8_t mac[ETHER_ADDR_LEN])
 {
 	int		rc = 0;
 	struct ifreq	ifr = {
@@ -208,47 +204,19 @@ if_setmac(ifctx ctx, const char *ifname, char mac[LLNAMSIZ])
 			.sa_len = ETHER_ADDR_LEN, /* binary mac size */
 		}
 	};
-	unsigned char	*bmac = (unsigned char *)(&ifr.ifr_addr.sa_data);
-
-#	define		BMAC_SCAN_ARGS \
-			mac, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", \
-			&bmac[0], &bmac[1], &bmac[2], \
-			&bmac[3], &bmac[4], &bmac[5]
-#	define		BMAC_PRINT_ARGS \
-			mac, "%02x:%02x:%02x:%02x:%02x:%02x", \
-			bmac[0], bmac[1], bmac[2], bmac[3], bmac[4], bmac[5]
 
+	assert(ctx >= 0);
 	assert(ifname != NULL && mac != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (strlen(mac) >= LLNAMSIZ) warnc(
-		EINVAL, "mac=\"%s\" too long", mac
-	), rc++;
-	if (sscanf(BMAC_SCAN_ARGS) != 6) warnc(
-		EINVAL, "mac=\"%s\" invalid", mac
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (NULL);
-	}
-
-	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
-	rc = ioctl(ctx, SIOCSIFLLADDR, &ifr);
-	if (rc != 0) {
-		warn("%s: ioctl(...SIOCSIFLLADDR...)", __func__);
-		return (NULL);
-	}
-	rc = sprintf(BMAC_PRINT_ARGS); /* normalize */
-	assert(rc == LLNAMLEN);
-#	undef BMAC_SCAN_ARGS
-#	undef BMAC_PRINT_ARGS
-
-	return (mac);
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
+	memcpy(ifr.ifr_addr.sa_data, mac, ETHER_ADDR_LEN);
+	if ((rc = ioctl(ctx, SIOCSIFLLADDR, &ifr)) != 0) warn(
+		"%s: ioctl(...SIOCSIFLLADDR...)", __func__
+	);
+	return (rc);
 }
 
 int
-if_addm(ifctx ctx, const char *ifname, const char *brname)
+if_addm(ifctx ctx, const ifname_t *ifname, const ifname_t *brname)
 {
 	int rc = 0;
 	struct ifbreq req = {0};
@@ -259,19 +227,8 @@ if_addm(ifctx ctx, const char *ifname, const char *brname)
 	};
 
 	assert(ifname != NULL && brname != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (strlen(brname) >= IFNAMSIZ) warnc(
-		EINVAL, "brname=\"%s\" too long", brname
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
-		return (-1);
-	}
-
-	strlcpy(req.ifbr_ifsname, ifname, sizeof(req.ifbr_ifsname));
-	strlcpy(ifd.ifd_name, brname, sizeof(ifd.ifd_name));
+	memcpy(req.ifbr_ifsname, ifname->name, sizeof(req.ifbr_ifsname));
+	memcpy(ifd.ifd_name, brname->name, sizeof(ifd.ifd_name));
 	if ((rc = ioctl(ctx, SIOCSDRVSPEC, &ifd)) != 0) warn(
 		"%s: ioctl(...SIOCSDRVSPEC...)", __func__
 	);
@@ -279,16 +236,15 @@ if_addm(ifctx ctx, const char *ifname, const char *brname)
 }
 
 static int
-getifflags(ifctx ctx, const char *ifname, uint32_t *flags)
+getifflags(ifctx ctx, const ifname_t *ifname, uint32_t *flags)
 {
 	int rc = 0;
 	struct ifreq ifr = {0};
 
 	assert(ctx >= 0);
 	assert(ifname != NULL);
-	assert(strlen(ifname) < IFNAMSIZ);
 
-	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
 	if ((rc = ioctl(ctx, SIOCGIFFLAGS, &ifr)) != 0) {
 		warn("%s: ioctl(...SIOCGIFFLAGS...)", __func__);
 		return (rc);
@@ -298,7 +254,7 @@ getifflags(ifctx ctx, const char *ifname, uint32_t *flags)
 }
 
 static int
-setifflags(ifctx ctx, const char *ifname, uint32_t flags)
+setifflags(ifctx ctx, const ifname_t *ifname, uint32_t flags)
 {
 	int rc = 0;
 	struct ifreq ifr = {
@@ -308,9 +264,8 @@ setifflags(ifctx ctx, const char *ifname, uint32_t flags)
 
 	assert(ctx >= 0);
 	assert(ifname != NULL);
-	assert(strlen(ifname) < IFNAMSIZ);
 
-	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
 	if ((rc = ioctl(ctx, SIOCSIFFLAGS, &ifr)) != 0) warn(
 		"%s: ioctl(...SIOCSIFFLAGS...)", __func__
 	);
@@ -318,22 +273,337 @@ setifflags(ifctx ctx, const char *ifname, uint32_t flags)
 }
 
 int
-if_up(ifctx ctx, const char *ifname)
+if_up(ifctx ctx, const ifname_t *ifname)
 {
 	int rc = 0;
 	uint32_t flags;
 
 	assert(ctx >= 0);
 	assert(ifname != NULL);
-	if (strlen(ifname) >= IFNAMSIZ) warnc(
-		EINVAL, "ifname=\"%s\" too long", ifname
-	), rc++;
-	if (rc) {
-		errno = EINVAL;
+
+	if ((rc = getifflags(ctx, ifname, &flags)) != 0)
+		return (rc);
+	return setifflags(ctx, ifname, flags | IFF_UP);
+}
+
+/*
+ * Interface groups let pf(4) and friends match on a handful of group names
+ * instead of every host end by name. Names were checked by ifgroup_check()
+ * (codec.c) before anything was created.
+ */
+int
+if_addgroup(ifctx ctx, const ifname_t *ifname, const char *group)
+{
+	int rc;
+	struct ifgroupreq ifgr = {0};
+
+	assert(ctx >= 0);
+	assert(ifname != NULL && group != NULL);
+
+	memcpy(ifgr.ifgr_name, ifname->name, sizeof(ifgr.ifgr_name));
+	strlcpy(ifgr.ifgr_group, group, sizeof(ifgr.ifgr_group));
+	if ((rc = ioctl(ctx, SIOCAIFGROUP, &ifgr)) != 0) warn(
+		"%s: ioctl(...SIOCAIFGROUP...)", __func__
+	);
+	return (rc);
+}
+
+int
+if_delgroup(ifctx ctx, const ifname_t *ifname, const char *group)
+{
+	int rc;
+	struct ifgroupreq ifgr = {0};
+
+	assert(ctx >= 0);
+	assert(ifname != NULL && group != NULL);
+
+	memcpy(ifgr.ifgr_name, ifname->name, sizeof(ifgr.ifgr_name));
+	strlcpy(ifgr.ifgr_group, group, sizeof(ifgr.ifgr_group));
+	if ((rc = ioctl(ctx, SIOCDIFGROUP, &ifgr)) != 0) warn(
+		"%s: ioctl(...SIOCDIFGROUP...)", __func__
+	);
+	return (rc);
+}
+
+/*
+ * Address configuration needs a socket of the right family, the AF_LOCAL one
+ * in ifctx won't do. These are rare enough to just open and close each time.
+ */
+static int
+afsock(int af)
+{
+	int sd;
+
+	if ((sd = socket(af, SOCK_DGRAM, 0)) == -1) warn(
+		"%s: socket(%d, SOCK_DGRAM, 0)", __func__, af
+	);
+	return (sd);
+}
+
+/* split "addr/plen" into `addr` and prefix length, -1 if bad */
+static int
+splitcidr(const char *cidr, char addr[INET6_ADDRSTRLEN], int max)
+{
+	const char *slash;
+	char *end;
+	long plen;
+
+	if ((slash = strchr(cidr, '/')) == NULL ||
+	    (size_t)(slash - cidr) >= INET6_ADDRSTRLEN)
+		return (-1);
+	memcpy(addr, cidr, slash - cidr);
+	addr[slash - cidr] = '\0';
+
+	errno = 0;
+	plen = strtol(slash + 1, &end, 10);
+	if (errno != 0 || *end != '\0' || end == slash + 1 ||
+	    plen < 0 || plen > max)
+		return (-1);
+	return ((int)plen);
+}
+
+static int
+addaddr4(const ifname_t *ifname, const struct in_addr *in, int plen)
+{
+	int sd, rc;
+	struct in_aliasreq ifra = {
+		.ifra_addr = {
+			.sin_len = sizeof(struct sockaddr_in),
+			.sin_family = AF_INET,
+			.sin_addr = *in
+		},
+		.ifra_mask = {
+			.sin_len = sizeof(struct sockaddr_in),
+			.sin_family = AF_INET,
+			.sin_addr.s_addr = (plen == 0) ?
+			    0 : htonl(0xffffffffU << (32 - plen))
+		}
+	};
+
+	/* broadcast is the default the kernel computes from the mask */
+	memcpy(ifra.ifra_name, ifname->name, sizeof(ifra.ifra_name));
+	if ((sd = afsock(AF_INET)) == -1)
 		return (-1);
+	if ((rc = ioctl(sd, SIOCAIFADDR, &ifra)) != 0) warn(
+		"%s: ioctl(...SIOCAIFADDR...)", __func__
+	);
+	(void) close(sd);
+	return (rc);
+}
+
+static int
+addaddr6(const ifname_t *ifname, const struct in6_addr *in6, int plen)
+{
+	int sd, rc, i;
+	struct in6_aliasreq ifra = {
+		.ifra_addr = {
+			.sin6_len = sizeof(struct sockaddr_in6),
+			.sin6_family = AF_INET6,
+			.sin6_addr = *in6
+		},
+		.ifra_prefixmask = {
+			.sin6_len = sizeof(struct sockaddr_in6),
+			.sin6_family = AF_INET6
+		},
+		.ifra_lifetime = {
+			.ia6t_vltime = ND6_INFINITE_LIFETIME,
+			.ia6t_pltime = ND6_INFINITE_LIFETIME
+		},
+		/*
+		 * Without this the address stays tentative for DAD after we
+		 * exit. Static addresses are the admin's to keep unique.
+		 */
+		.ifra_flags = IN6_IFF_NODAD
+	};
+	uint8_t *mask = ifra.ifra_prefixmask.sin6_addr.s6_addr;
+
+	for (i = 0; i < plen / 8; i++)
+		mask[i] = 0xff;
+	if (plen % 8)
+		mask[i] = (0xff00 >> (plen % 8)) & 0xff;
+
+	memcpy(ifra.ifra_name, ifname->name, sizeof(ifra.ifra_name));
+	if ((sd = afsock(AF_INET6)) == -1)
+		return (-1);
+	if ((rc = ioctl(sd, SIOCAIFADDR_IN6, &ifra)) != 0) warn(
+		"%s: ioctl(...SIOCAIFADDR_IN6...)", __func__
+	);
+	(void) close(sd);
+	return (rc);
+}
+
+/*
+ * `cidr` is "addr/plen" for either IPv4 or IPv6, the family is decided by
+ * which inet_pton(3) accepts. The prefix length is required, guessing
+ * classful masks like ifconfig(8) does is not doing anyone a favor.
+ */
+/* parse "addr/plen" into `in` or `in6` by family, AF_UNSPEC if bad */
+static int
+parsecidr(const char *cidr, struct in_addr *in, struct in6_addr *in6,
+    int *plen)
+{
+	char addr[INET6_ADDRSTRLEN];
+
+	if ((*plen = splitcidr(cidr, addr, 32)) != -1 &&
+	    inet_pton(AF_INET, addr, in) == 1)
+		return (AF_INET);
+	if ((*plen = splitcidr(cidr, addr, 128)) != -1 &&
+	    inet_pton(AF_INET6, addr, in6) == 1)
+		return (AF_INET6);
+	return (AF_UNSPEC);
+}
+
+/*
+ * Family of `cidr` without touching any interface so main() can refuse a bad
+ * -a before anything is created. AF_UNSPEC if it isn't addr/plen.
+ */
+int
+if_addrfamily(const char *cidr)
+{
+	int plen;
+	struct in_addr in;
+	struct in6_addr in6;
+
+	assert(cidr != NULL);
+	return parsecidr(cidr, &in, &in6, &plen);
+}
+
+int
+if_addaddr(ifctx ctx, const ifname_t *ifname, const char *cidr)
+{
+	int plen;
+	struct in_addr in;
+	struct in6_addr in6;
+
+	assert(ctx >= 0);
+	assert(ifname != NULL && cidr != NULL);
+	switch (parsecidr(cidr, &in, &in6, &plen)) {
+	case AF_INET:
+		return addaddr4(ifname, &in, plen);
+	case AF_INET6:
+		return addaddr6(ifname, &in6, plen);
+	}
+	/* main() already checked with if_addrfamily() */
+	warnc(EINVAL, "address=\"%s\" invalid", cidr);
+	errno = EINVAL;
+	return (-1);
+}
+
+/*
+ * Clear ND6_IFF_IFDISABLED so IPv6 works on `ifname` and when `linklocal` is
+ * set also ND6_IFF_AUTO_LINKLOCAL so bringing it up assigns a fe80:: address.
+ * Same as `ifconfig ifname inet6 -ifdisabled auto_linklocal`.
+ */
+int
+if_inet6_enable(ifctx ctx, const ifname_t *ifname, int linklocal)
+{
+	int sd, rc = 0;
+	struct in6_ndireq nd = {0};
+
+	assert(ctx >= 0);
+	assert(ifname != NULL);
+	memcpy(nd.ifname, ifname->name, sizeof(nd.ifname));
+	if ((sd = afsock(AF_INET6)) == -1)
+		return (-1);
+	if ((rc = ioctl(sd, SIOCGIFINFO_IN6, &nd)) != 0) {
+		warn("%s: ioctl(...SIOCGIFINFO_IN6...)", __func__);
+		(void) close(sd);
+		return (rc);
 	}
+	nd.ndi.flags &= ~ND6_IFF_IFDISABLED;
+	if (linklocal)
+		nd.ndi.flags |= ND6_IFF_AUTO_LINKLOCAL;
+	if ((rc = ioctl(sd, SIOCSIFINFO_IN6, &nd)) != 0) warn(
+		"%s: ioctl(...SIOCSIFINFO_IN6...)", __func__
+	);
+	(void) close(sd);
+	return (rc);
+}
+
+int
+if_delm(ifctx ctx, const ifname_t *ifname, const ifname_t *brname)
+{
+	int rc = 0;
+	struct ifbreq req = {0};
+	struct ifdrv ifd = {
+		.ifd_cmd = BRDGDEL,
+		.ifd_len = sizeof(req),
+		.ifd_data = &req
+	};
+
+	assert(ifname != NULL && brname != NULL);
+	memcpy(req.ifbr_ifsname, ifname->name, sizeof(req.ifbr_ifsname));
+	memcpy(ifd.ifd_name, brname->name, sizeof(ifd.ifd_name));
+	if ((rc = ioctl(ctx, SIOCSDRVSPEC, &ifd)) != 0) warn(
+		"%s: ioctl(...SIOCSDRVSPEC...)", __func__
+	);
+	return (rc);
+}
+
+int
+if_down(ifctx ctx, const ifname_t *ifname)
+{
+	int rc = 0;
+	uint32_t flags;
+
+	assert(ctx >= 0);
+	assert(ifname != NULL);
 
 	if ((rc = getifflags(ctx, ifname, &flags)) != 0)
 		return (rc);
-	return setifflags(ctx, ifname, flags | IFF_UP);
+	return setifflags(ctx, ifname, flags & ~IFF_UP);
+}
+
+/*
+ * 1 when `ifname` is up, running and has link, 0 when not (yet), -1 on error.
+ * Link state comes from SIOCGIFDATA, the same if_data ifconfig(8) reports
+ * as "status: active".
+ */
+int
+if_running(ifctx ctx, const ifname_t *ifname)
+{
+	uint32_t flags;
+	struct if_data ifd;
+	struct ifreq ifr = {
+		.ifr_data = (caddr_t)&ifd
+	};
+
+	assert(ctx >= 0);
+	assert(ifname != NULL);
+
+	if (getifflags(ctx, ifname, &flags) != 0)
+		return (-1);
+	memcpy(ifr.ifr_name, ifname->name, sizeof(ifr.ifr_name));
+	if (ioctl(ctx, SIOCGIFDATA, &ifr) != 0) {
+		warn("%s: ioctl(...SIOCGIFDATA...)", __func__);
+		return (-1);
+	}
+	return ((flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING) &&
+	    ifd.ifi_link_state == LINK_STATE_UP);
+}
+
+/*
+ * 1 when bridge member `ifname` is forwarding, 0 when not (yet), -1 on error.
+ * Without STP on the port there is no state to wait on, the port state is
+ * only meaningful when IFBIF_STP is set.
+ */
+int
+if_forwarding(ifctx ctx, const ifname_t *ifname, const ifname_t *brname)
+{
+	struct ifbreq req = {0};
+	struct ifdrv ifd = {
+		.ifd_cmd = BRDGGIFFLGS,
+		.ifd_len = sizeof(req),
+		.ifd_data = &req
+	};
+
+	assert(ifname != NULL && brname != NULL);
+	memcpy(req.ifbr_ifsname, ifname->name, sizeof(req.ifbr_ifsname));
+	memcpy(ifd.ifd_name, brname->name, sizeof(ifd.ifd_name));
+	if (ioctl(ctx, SIOCGDRVSPEC, &ifd) != 0) {
+		warn("%s: ioctl(...SIOCGDRVSPEC...)", __func__);
+		return (-1);
+	}
+	return (!(req.ifbr_ifsflags & IFBIF_STP) ||
+	    req.ifbr_state == BSTP_IFSTATE_FORWARDING);
 }
@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <err.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -65,14 +66,32 @@
 
 #define USAGE do { \
 	(void) fprintf(stderr, \
-		"USAGE: " ME " [-n] <jail> <if-host> <if-bridge> <if-jail> [mac]\n" \
+		"USAGE: " ME " [-nl] [-w timeout] [-g group]... [-G group]...\n" \
+		"\t[-a addr/plen]... [-r gateway]... [-J journal]\n" \
+		"\t<jail> <if-host> <if-bridge> <if-jail> [mac]\n" \
+		"       " ME " -R -J journal\n" \
 		"\n" \
 		"-n\tDisable automatic loading of network interface drivers.\n" \
+		"-g\tAdd <if-host> to interface group, may be repeated.\n" \
+		"-G\tAdd <if-jail> to interface group, may be repeated.\n" \
+		"-a\tAssign IPv4 or IPv6 address to <if-jail>, may be repeated.\n" \
+		"-r\tAdd default route in <jail> via IPv4 or IPv6 gateway,\n" \
+		"\tat most one of each.\n" \
+		"-l\tEnable IPv6 link-local address on <if-jail>.\n" \
+		"-w\tWait up to timeout seconds for <if-host> to be up and\n" \
+		"\trunning with link and forwarding on <if-bridge> (at once\n" \
+		"\tunless STP is enabled on the new port), fail if not.\n" \
+		"\tAny of -a, -r, -l or -w also brings <if-jail> up.\n" \
+		"-J\tRecord progress in journal, rolling back runs that\n" \
+		"\tdied part way in it first if no others are in progress.\n" \
+		"\tEntries from an earlier boot are ignored.\n" \
+		"-R\tOnly roll back runs that died part way from journal.\n" \
 		"<jail>\ta valid jail name or ID.\n" \
 		"<if-*>\tparameters must all be valid interface names.\n" \
 		"[mac]\tis optional but if provided will be assigned to\n" \
 		"\t<if-jail>, the epair(4) that remains in <jail>.\n" \
-		"\tThis can be useful for configuring DHCP.\n\n" \
+		"\tThis can be useful for configuring DHCP. Octets may be\n" \
+		"\tseparated by ':' or '-', multicast is refused.\n\n" \
 		"epair(4) nodes are created in <jail> with one end remaining in the\n" \
 		"jail and one pulled out from the jail to connect to an already\n" \
 		"existing if_bridge(4).\n\n" \
@@ -82,6 +101,8 @@
 		"EXAMPLE (assuming jail0br and lan0br are existing if_bridge(4)):\n"\
 		"\t" ME " test jail0test jail0br jail0\n"\
 		"\t" ME " test lan0test lan0br lan0\n"\
+		"\t" ME " -g jep -g tenant test lan0test lan0br lan0\n"\
+		"\t" ME " -a 10.0.0.5/24 -r 10.0.0.1 -l test jail0test jail0br jail0\n"\
 	); \
 	exit(EX_USAGE); \
 } while(0)
@@ -92,32 +113,55 @@ static struct {
 	int		 ipc;		/* our side of socketpair */
 	ifctx		 ifc;		/* needed by all if_* routines */
 	int		 jid;		
-	const char	*clean_if;	/* interface name to destroy on err */
 	/* from argv */
 	const char	*jail;		/* from argv in roundabout way */
-	const char	*ifhost;
-	const char	*ifbridge;
-	const char	*ifjail;
-	const char	*mac;
+	ifname_t	 ifhost;
+	ifname_t	 ifbridge;
+	ifname_t	 ifjail;
+	int		 setmac;	/* mac given, otherwise read into */
+	uint8_t		 mac[ETHER_ADDR_LEN];
+	const char	**hgroups;	/* from -g */
+	int		 nhgroups;
+	const char	**jgroups;	/* from -G */
+	int		 njgroups;
+	const char	**addrs;	/* from -a */
+	int		 naddrs;
+	const char	**routes;	/* from -r */
+	int		 nroutes;
+	int		 linklocal;	/* from -l */
+	int		 inet6;		/* -l or any IPv6 -a or -r */
+	int		 wait;		/* from -w, seconds or -1 to not */
+	const char	*journal;	/* from -J */
 } G = {
 	.ipc		= -1,
 	.ifc		= -1,
 	.jid		= -1,
-	.clean_if	= NULL,
 	.jail		= NULL,
-	.ifhost		= NULL,
-	.ifbridge	= NULL,
-	.ifjail		= NULL,
-	.mac		= NULL,
+	.ifhost		= { "" },
+	.ifbridge	= { "" },
+	.ifjail		= { "" },
+	.setmac		= 0,
+	.mac		= { 0 },
+	.hgroups	= NULL,
+	.nhgroups	= 0,
+	.jgroups	= NULL,
+	.njgroups	= 0,
+	.addrs		= NULL,
+	.naddrs		= 0,
+	.routes		= NULL,
+	.nroutes	= 0,
+	.linklocal	= 0,
+	.inet6		= 0,
+	.wait		= -1,
+	.journal	= NULL,
 };
 
 static void
 err_cleanup_child(int _)
 {
-	/* may or may not be far enough to need to clean epair */
-	if (G.clean_if) {
-		(void) if_epair_destroy(G.ifc, G.clean_if);
-	}
+	/* undo however far we got, may be nothing, journal done if it all was */
+	if (undo_unwind(G.ifc) == 0)
+		jnl_commit();
 	/* by closing without writing mac parent knows error occurred */
 	(void) shutdown(G.ipc, SHUT_RDWR);
 	(void) close(G.ipc);
@@ -129,6 +173,12 @@ err_cleanup_parent(int _)
 {
 	int wc, status;
 
+	/*
+	 * Undo our side, then the child destroying its end of the epair takes
+	 * the host end with it wherever it is, no need to push it back.
+	 */
+	(void) undo_unwind(G.ifc);
+
 	/* ask child to handle cleanup */
 	(void) write(G.ipc, "errout", sizeof("errout"));
 
@@ -178,48 +228,116 @@ gfork(process child, process parent)
 	}
 }
 
+/*
+ * -w for the host end, `start` was taken before it was brought up. Not ready
+ * in time is as good as failed, so it unwinds the same. The jail end isn't
+ * waited for: epair(4) has it running with link from creation and if_up()
+ * sets IFF_UP before returning, there is nothing to wait for.
+ */
+static void
+waitready(int rs, const ifname_t *ifname, const ifname_t *brname,
+    int64_t start)
+{
+	int ms;
+
+	if ((ms = rt_wait_ready(
+	    rs, G.ifc, ifname, brname, start, G.wait * 1000)) == -1) {
+		if (errno == ETIMEDOUT) errx(
+			EX_UNAVAILABLE, "\"%s\" not ready after %ds",
+			ifname->name, G.wait
+		);
+		errx(ERREXIT, "unable to wait for \"%s\"", ifname->name);
+	}
+	(void) close(rs);
+	warnx("\"%s\" ready in %dms", ifname->name, ms);
+}
+
 /* child is in the jail */
 static int
 child(void)
 {
 	int idx;
-	const char *mac;
 	char macbuf[LLNAMSIZ] = { '\0', };
-	char epair[IFNAMSIZ] = { '\0' };
+	ifname_t epair;
 
-	if (if_epair_create(G.ifc, epair) == NULL) errx(
+	if (if_epair_create(G.ifc, &epair) == NULL) errx(
 		ERREXIT, "unable to create epair in jail \"%s\"", G.jail
 	);
-	G.clean_if = epair;
+	undo_push(UNDO_DESTROY, &epair, NULL);
 
 	/* set or retrieve mac of epair in jail we report it later */
-	if (G.mac != NULL) {
-		strlcpy(macbuf, G.mac, sizeof(macbuf));
-		if ((mac = if_setmac(G.ifc, epair, macbuf)) == NULL) errx(
-			ERREXIT, "unable to set mac=\"%s\"", G.mac
+	if (G.setmac) {
+		if (if_setmac(G.ifc, &epair, G.mac) != 0) errx(
+			ERREXIT, "unable to set mac=\"%s\"",
+			mac_format(G.mac, macbuf)
 		);
 	} else {
-		if ((mac = if_getmac(G.ifc, epair, macbuf)) == NULL) errx(
-			ERREXIT, "unable to retrieve mac for \"%s\"", epair
+		if (if_getmac(G.ifc, &epair, G.mac) != 0) errx(
+			ERREXIT, "unable to retrieve mac for \"%s\"", epair.name
 		);
 	}
-	
-	if (if_rename(G.ifc, epair, G.ifjail) < 0) errx(
-		ERREXIT, "unable to rename \"%s\" -> \"%s\"", epair, G.ifjail
+	(void) mac_format(G.mac, macbuf);
+	jnl_create(G.ifc, &epair);
+
+	if (if_rename(G.ifc, &epair, &G.ifjail) < 0) errx(
+		ERREXIT, "unable to rename \"%s\" -> \"%s\"", epair.name,
+		G.ifjail.name
 	);
-	G.clean_if = G.ifjail; /* in case of err, epair name has changed */
+	undo_rename(&epair, &G.ifjail);
+	jnl_step("rename");
+
+	for (idx = 0; idx < G.njgroups; idx++) {
+		if (if_addgroup(G.ifc, &G.ifjail, G.jgroups[idx]) != 0) errx(
+			ERREXIT, "unable to add \"%s\" to group \"%s\"",
+			G.ifjail.name, G.jgroups[idx]
+		);
+		undo_push(UNDO_DELGROUP, &G.ifjail, G.jgroups[idx]);
+	}
+
+	/*
+	 * We are already in the jail vnet so configure the jail end right
+	 * here, saves waiting on rc(8) in the jail to do it. Addresses before
+	 * routes as the gateway has to be reachable. Neither is logged for
+	 * undo, they only exist as long as the epair does.
+	 */
+	if (G.naddrs || G.nroutes || G.linklocal || G.wait >= 0) {
+		/* IPv6 is useless on the interface while ND6 has it disabled */
+		if (G.inet6 &&
+		    if_inet6_enable(G.ifc, &G.ifjail, G.linklocal) != 0) errx(
+			ERREXIT, "unable to enable inet6 on \"%s\"",
+			G.ifjail.name
+		);
+		if (if_up(G.ifc, &G.ifjail) != 0) errx(
+			ERREXIT, "unable to bring \"%s\" up", G.ifjail.name
+		);
+		undo_push(UNDO_DOWN, &G.ifjail, NULL);
+	}
+	for (idx = 0; idx < G.naddrs; idx++) {
+		if (if_addaddr(G.ifc, &G.ifjail, G.addrs[idx]) != 0) errx(
+			ERREXIT, "unable to add \"%s\" to \"%s\"",
+			G.addrs[idx], G.ifjail.name
+		);
+	}
+	for (idx = 0; idx < G.nroutes; idx++) {
+		if (rt_default(&G.ifjail, G.routes[idx]) != 0) errx(
+			ERREXIT, "unable to add default route via \"%s\"",
+			G.routes[idx]
+		);
+	}
 
 	/* We know it is `epairXa` and X must be at least 1 digit. */
-	for (idx = sizeof("epair"); epair[idx] != '\0'; idx++)
+	for (idx = sizeof("epair"); epair.name[idx] != '\0'; idx++)
 		; /* just advancing idx */
-	epair[--idx] = 'b';
+	epair.name[--idx] = 'b';
 
-	if (if_rename(G.ifc, epair, G.ifhost) < 0) errx(
-		ERREXIT, "unable to rename \"%s\" -> \"%s\"", epair, G.ifhost
+	if (if_rename(G.ifc, &epair, &G.ifhost) < 0) errx(
+		ERREXIT, "unable to rename \"%s\" -> \"%s\"", epair.name,
+		G.ifhost.name
 	);
+	undo_rename(&epair, &G.ifhost);
 
 	/* inform our parent of the mac address */
-	if (write(G.ipc, mac, LLNAMSIZ) != LLNAMSIZ) errx(
+	if (write(G.ipc, macbuf, LLNAMSIZ) != LLNAMSIZ) errx(
 		ERREXIT, "unable to report mac to parent"
 	);
 
@@ -228,6 +346,7 @@ child(void)
 		err_cleanup_child(0);
 		return (0); /* not used by parent if they told child to cleanup */
 	}
+	undo_clear();
 
 	(void) shutdown(G.ipc, SHUT_RDWR);
 	(void) close(G.ipc);
@@ -238,9 +357,9 @@ child(void)
 static int
 parent(void)
 {
-	int rc, wc, status;
+	int idx, rc, wc, status, rs = -1;
+	int64_t start;
 	char macbuf[LLNAMSIZ] = { '\0', };
-	G.mac = macbuf;
 
 	/*
 	 * If child process has any failure it is just going to close its side
@@ -251,15 +370,38 @@ parent(void)
 	if ((rc = read(G.ipc, macbuf, LLNAMSIZ)) != LLNAMSIZ)
 		goto out;
 
-	if (if_vmove(G.ifc, G.ifhost, G.jid) == -1) errx(
-		ERREXIT, "unable to retrieve \"%s\" from \"%s\"", G.ifhost, G.jail
+	if (if_vmove(G.ifc, &G.ifhost, G.jid) == -1) errx(
+		ERREXIT, "unable to retrieve \"%s\" from \"%s\"", G.ifhost.name,
+		G.jail
 	);
-	if (if_addm(G.ifc, G.ifhost, G.ifbridge) == -1) errx(
-		ERREXIT, "unable to addm \"%s\" to \"%s\"", G.ifhost, G.ifbridge
+	jnl_step("vmove");
+
+	/* groups don't survive the vnet move so can only be set here */
+	for (idx = 0; idx < G.nhgroups; idx++) {
+		if (if_addgroup(G.ifc, &G.ifhost, G.hgroups[idx]) != 0) errx(
+			ERREXIT, "unable to add \"%s\" to group \"%s\"",
+			G.ifhost.name, G.hgroups[idx]
+		);
+		undo_push(UNDO_DELGROUP, &G.ifhost, G.hgroups[idx]);
+	}
+	if (if_addm(G.ifc, &G.ifhost, &G.ifbridge) == -1) errx(
+		ERREXIT, "unable to addm \"%s\" to \"%s\"", G.ifhost.name,
+		G.ifbridge.name
 	);
-	if (if_up(G.ifc, G.ifhost) != 0) errx(
-		ERREXIT, "unable to bring \"%s\" up", G.ifhost
+	undo_push(UNDO_DELM, &G.ifhost, G.ifbridge.name);
+	jnl_step("addm");
+	if (G.wait >= 0 && (rs = rt_watch()) == -1) errx(
+		ERREXIT, "unable to watch for \"%s\" coming up", G.ifhost.name
 	);
+	start = rt_msnow();
+	if (if_up(G.ifc, &G.ifhost) != 0) errx(
+		ERREXIT, "unable to bring \"%s\" up", G.ifhost.name
+	);
+	jnl_step("up");
+	if (G.wait >= 0)
+		waitready(rs, &G.ifhost, &G.ifbridge, start);
+	undo_clear();
+	jnl_commit();
 
 	/* Important to shutdown G.ipc so child exits clean */
 	(void) shutdown(G.ipc, SHUT_RDWR);
@@ -267,7 +409,7 @@ parent(void)
 	(void) close(G.ifc);
 
 	/* XXX this may change when I write something to consume it ... */
-	(void) fprintf(stdout, "{\"%s\": \"%s\"}\n", G.jail, G.mac);
+	(void) fprintf(stdout, "{\"%s\": \"%s\"}\n", G.jail, macbuf);
 
 out:
 	do {
@@ -285,45 +427,156 @@ out:
 int
 main(int argc, char **argv)
 {
+	int ch, kld = 1, replay = 0, idx, af, afs = 0;
+	long timeout;
+	char *end;
+	static struct jt_entry je;	/* G.jail points into this */
+
 	setvbuf(stdout, NULL, _IONBF, BUFSIZ);
 
-	/* enough args to check for '-n' */
-	if (argc < 2) USAGE;
+	/*
+	 * There can never be more groups (or addresses or routes) than
+	 * arguments so size them that way. Like the jail name these are never
+	 * free()ed.
+	 */
+	if ((G.hgroups = calloc(argc, sizeof(*G.hgroups))) == NULL ||
+	    (G.jgroups = calloc(argc, sizeof(*G.jgroups))) == NULL ||
+	    (G.addrs = calloc(argc, sizeof(*G.addrs))) == NULL ||
+	    (G.routes = calloc(argc, sizeof(*G.routes))) == NULL) err(
+		EX_OSERR, "calloc"
+	);
+
+	while ((ch = getopt(argc, argv, "a:lnr:w:G:g:J:R")) != -1) {
+		switch (ch) {
+		case 'a':
+			G.addrs[G.naddrs++] = optarg;
+			break;
+		case 'l':
+			G.linklocal = 1;
+			break;
+		case 'n':
+			kld = 0;
+			break;
+		case 'r':
+			G.routes[G.nroutes++] = optarg;
+			break;
+		case 'w':
+			errno = 0;
+			timeout = strtol(optarg, &end, 10);
+			if (errno != 0 || *end != '\0' || end == optarg ||
+			    timeout < 0 || timeout > INT_MAX / 1000)
+				USAGE;
+			G.wait = timeout;
+			break;
+		case 'g':
+			G.hgroups[G.nhgroups++] = optarg;
+			break;
+		case 'G':
+			G.jgroups[G.njgroups++] = optarg;
+			break;
+		case 'J':
+			G.journal = optarg;
+			break;
+		case 'R':
+			replay = 1;
+			break;
+		default:
+			USAGE;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	/* just recover from the journal, nothing else */
+	if (replay) {
+		if (G.journal == NULL || argc != 0) USAGE;
+		return (jnl_replay(G.journal) == 0) ? 0 : EX_OSERR;
+	}
+	if (argc < 4 || argc > 5) USAGE;
 
 	/*
 	 * Unless told not to, check for kernel modules and attempt to add them
 	 * if not already present.
 	 */
-	if (strcmp(argv[1], "-n") == 0) {
-		/* adjust arguments so we can ignore "-n" */
-		argv++; argc--;
-	} else {
+	if (kld) {
 		kld_ensure_load("if_epair");
 		kld_ensure_load("if_bridge");
 	}
-	if (argc < 5 || argc > 6) USAGE;
 
-	G.ifhost = argv[2];
-	G.ifbridge = argv[3];
-	G.ifjail = argv[4];
-	G.mac = (argc == 6) ? argv[5] : NULL;
+	/* names, groups and mac are checked only here, the rest trusts them */
+	if (ifname_set(&G.ifhost, argv[1]) != 0 ||
+	    ifname_set(&G.ifbridge, argv[2]) != 0 ||
+	    ifname_set(&G.ifjail, argv[3]) != 0)
+		exit(EX_USAGE);
+	for (idx = 0; idx < G.nhgroups; idx++) {
+		if (ifgroup_check(G.hgroups[idx]) != 0)
+			exit(EX_USAGE);
+	}
+	for (idx = 0; idx < G.njgroups; idx++) {
+		if (ifgroup_check(G.jgroups[idx]) != 0)
+			exit(EX_USAGE);
+	}
+	if (argc == 5) {
+		if (mac_parse(argv[4], G.mac) != 0) errx(
+			EX_USAGE, "mac=\"%s\" invalid", argv[4]
+		);
+		G.setmac = 1;
+	}
 
-	/* need the jail id */
-	if ((G.jid = jail_getid(argv[1])) == -1) errx(
-		ERREXIT, "%s", jail_errmsg
-	);
+	/*
+	 * Addresses and gateways are only used once the epair exists, so parse
+	 * them now rather than have a typo cost a create and rollback. A second
+	 * default of the same family would only fail with EEXIST in the jail
+	 * after the addresses are already on, so refuse that up front too.
+	 */
+	G.inet6 = G.linklocal;
+	for (idx = 0; idx < G.naddrs; idx++) {
+		if ((af = if_addrfamily(G.addrs[idx])) == AF_UNSPEC) errx(
+			EX_USAGE, "address=\"%s\" must be addr/plen",
+			G.addrs[idx]
+		);
+		G.inet6 |= (af == AF_INET6);
+	}
+	for (idx = 0; idx < G.nroutes; idx++) {
+		if ((af = rt_family(G.routes[idx])) == AF_UNSPEC) errx(
+			EX_USAGE, "gateway=\"%s\" invalid", G.routes[idx]
+		);
+		if (afs & (1 << af)) errx(
+			EX_USAGE, "gateway=\"%s\" second %s default route",
+			G.routes[idx], (af == AF_INET) ? "IPv4" : "IPv6"
+		);
+		afs |= (1 << af);
+	}
+	G.inet6 |= ((afs & (1 << AF_INET6)) != 0);
+
+	/*
+	 * Worst case undo log is the jail side: create, 2 renames, up and the
+	 * -G groups. Host side is smaller apart from -g groups.
+	 */
+	undo_init(G.nhgroups + G.njgroups + 4);
 
 	/*
-	 * User may have given us numeric ID so ensure we have name for later.
-	 * This name is malloc()ed but not worth worrying about free()ing.
+	 * Need the jail id and, as user may have given us numeric ID, the name
+	 * for later. One jail_get(2) gives us both plus whether the jail even
+	 * has a vnet, no point going any further if it doesn't.
 	 *
 	 * XXX still not sure I want to print jail name, we have that in
 	 *     jail.conf(5) anyway so any utility that uses mac probably
 	 *     doesn't need this...
 	 */
-	if ((G.jail = jail_getname(G.jid)) == NULL) errx(
+	if ((G.jid = jt_fetch(argv[0], &je)) == -1) errx(
 		ERREXIT, "%s", jail_errmsg
 	);
+	if (!je.vnet) errx(
+		EX_USAGE, "jail \"%s\" does not have its own vnet", je.name
+	);
+	G.jail = je.name;
+
+	if (G.journal != NULL) {
+		jnl_open(G.journal);
+		jnl_intent(G.jail, G.jid, G.ifhost.name, G.ifbridge.name,
+		    G.ifjail.name);
+	}
 
 	return gfork(child, parent);
 }
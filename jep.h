@@ -26,6 +26,9 @@
 #define _DMARKER_FREEDAVE_NET_JEP_H_
 
 #include <errno.h>
+#include <stdint.h>
+#include <sys/param.h>
+#include <net/ethernet.h>
 #include <net/if.h>
 #include <sysexits.h>
 
@@ -40,6 +43,30 @@
 
 typedef int (*process)(void);
 
+/* an interface name that has been through ifname_set() */
+typedef struct {
+	char	 name[IFNAMSIZ];
+} ifname_t;
+
+/* MAC and interface name parsing: codec.c */
+int		 mac_parse(const char *, uint8_t[ETHER_ADDR_LEN]);
+char		*mac_format(const uint8_t[ETHER_ADDR_LEN], char[LLNAMSIZ]);
+int		 ifname_set(ifname_t *, const char *);
+int		 ifgroup_check(const char *);
+
+/* jail lookup: jt.c */
+struct jt_entry {
+	int	 jid;
+	int	 parent;			/* JID of parent jail */
+	int	 vnet;				/* has its own vnet(9) */
+	char	 name[MAXHOSTNAMELEN];
+};
+
+int		 jt_fetch(const char *, struct jt_entry *);
+int		 jt_load(void);
+struct jt_entry	*jt_lookup(const char *);
+int		 jt_revalidate(struct jt_entry *);
+
 /* module loading: kld.c */
 void	kld_ensure_load(const char *);
 
@@ -48,13 +75,56 @@ typedef int ifctx;
 
 ifctx		 if_open_ctx();
 
-char		*if_epair_create(ifctx, char[IFNAMSIZ]);
-int		 if_epair_destroy(ifctx, const char *);
-int		 if_rename(ifctx, const char *, const char *);
-int		 if_vmove(ifctx, const char *, int);
-int		 if_addm(ifctx, const char *, const char *);
-const char	*if_setmac(ifctx, const char *, char[LLNAMSIZ]);
-char		*if_getmac(ifctx, const char *, char[LLNAMSIZ]);
-int		 if_up(ifctx, const char *);
+ifname_t	*if_epair_create(ifctx, ifname_t *);
+int		 if_epair_destroy(ifctx, const ifname_t *);
+int		 if_rename(ifctx, const ifname_t *, const ifname_t *);
+int		 if_vmove(ifctx, const ifname_t *, int);
+int		 if_addm(ifctx, const ifname_t *, const ifname_t *);
+int		 if_delm(ifctx, const ifname_t *, const ifname_t *);
+int		 if_setmac(ifctx, const ifname_t *, const uint8_t[]);
+int		 if_getmac(ifctx, const ifname_t *, uint8_t[ETHER_ADDR_LEN]);
+int		 if_getident(ifctx, const ifname_t *, uint8_t[ETHER_ADDR_LEN],
+		    intmax_t *);
+int		 if_up(ifctx, const ifname_t *);
+int		 if_down(ifctx, const ifname_t *);
+int		 if_addgroup(ifctx, const ifname_t *, const char *);
+int		 if_delgroup(ifctx, const ifname_t *, const char *);
+int		 if_addrfamily(const char *);
+int		 if_addaddr(ifctx, const ifname_t *, const char *);
+int		 if_inet6_enable(ifctx, const ifname_t *, int);
+int		 if_running(ifctx, const ifname_t *);
+int		 if_forwarding(ifctx, const ifname_t *, const ifname_t *);
+
+/* compensating actions: undo.c */
+enum undo_op {
+	UNDO_DESTROY,		/* epair created */
+	UNDO_RENAME,		/* interface renamed, arg is old name */
+	UNDO_DELGROUP,		/* added to group arg */
+	UNDO_DOWN,		/* brought up */
+	UNDO_DELM,		/* added to bridge arg */
+};
+
+void		 undo_init(size_t);
+void		 undo_push(enum undo_op, const ifname_t *, const char *);
+void		 undo_rename(const ifname_t *, const ifname_t *);
+int		 undo_unwind(ifctx);
+void		 undo_clear(void);
+
+/* intent journal: jnl.c */
+void		 jnl_open(const char *);
+int		 jnl_replay(const char *);
+void		 jnl_intent(const char *, int, const char *, const char *,
+		    const char *);
+void		 jnl_create(ifctx, const ifname_t *);
+void		 jnl_step(const char *);
+void		 jnl_commit(void);
+
+/* routing socket functions: rt.c */
+int		 rt_family(const char *);
+int		 rt_default(const ifname_t *, const char *);
+int		 rt_watch(void);
+int64_t		 rt_msnow(void);
+int		 rt_wait_ready(int, ifctx, const ifname_t *, const ifname_t *,
+		    int64_t, int);
 
 #endif /* _DMARKER_FREEDAVE_NET_JEP_H_ */
@@ -0,0 +1,531 @@
+/*-
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2025 David Marker
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/file.h>
+#include <sys/jail.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <jail.h>
+
+#include "jep.h"
+
+/*
+ * Intent journal so a run killed part way (say between if_vmove and if_addm)
+ * can be found and rolled back later without scanning every interface on the
+ * host. Each run appends one line per record:
+ *
+ *	I <key> <boot> <jid> <if-host> <if-bridge> <if-jail> <jail>
+ *	S <key> create <epair> <mac> <epoch>
+ *	S <key> <step>
+ *	C <key>
+ *
+ * An intent, the steps reached and finally a commit once the run either
+ * succeeded or its undo log cleaned up after it. Only entries without a commit
+ * need any attention. The create step records what the epair is, not just
+ * its name, so recovery never destroys an interface a later run created
+ * under the same names.
+ *
+ * Every record is a single write(2) to an O_APPEND descriptor so concurrent
+ * runs don't interleave. There is no fsync(2): what we recover from is a
+ * process dying, the page cache has the records regardless. A crash of the
+ * whole host takes every jail and epair with it, and after it every field
+ * used to match an epair can repeat, so entries of any other boot are
+ * dropped. <boot> is a random token kept in JNL_BOOTFILE, which
+ * rc.d/cleanvar empties at boot. kern.boottime won't do: it moves whenever
+ * the clock is stepped (ntpd early in boot) and would drop entries of this
+ * very boot.
+ *
+ * Runs hold a shared flock(2) on the journal. Replay needs it exclusively, so
+ * it only ever sees entries of runs that are gone, and then truncates the
+ * journal down to the entries it failed to roll back. Cost is the size of the
+ * journal since the last replay, not the number of interfaces.
+ */
+
+#define	JNL_KEYLEN	32
+#define	JNL_BOOTFILE	"/var/run/jep.boot"
+
+static struct {
+	int	 fd;			/* -1 when not journaling */
+	char	 key[JNL_KEYLEN];	/* of this run */
+	uint64_t boot;			/* 0 until boottoken() has it */
+} J = {
+	.fd	= -1,
+	.key	= { '\0' },
+	.boot	= 0,
+};
+
+/* one run as read back from the journal */
+struct jnl_entry {
+	char	 key[JNL_KEYLEN];
+	uintmax_t boot;
+	int	 jid;
+	ifname_t ifhost;		/* all filled by %15s so fit */
+	ifname_t ifbridge;
+	ifname_t ifjail;
+	ifname_t epair;
+	uint8_t	 mac[ETHER_ADDR_LEN];	/* with epoch identify the epair */
+	intmax_t epoch;
+	int	 ident;			/* mac and epoch were recorded */
+	char	 step[16];
+	int	 closed;
+	int	 keep;			/* not rolled back, try again later */
+	char	 jail[MAXHOSTNAMELEN];
+};
+
+/*
+ * Random token for this boot, the first run after boot makes it. It is
+ * written whole under a temporary name and link(2)ed into place so a run
+ * racing us either sees all of it or loses the link and reads ours. Returns
+ * 0 (never a valid token) if it can't be had.
+ */
+static uint64_t
+boottoken(void)
+{
+	int fd, rc, tries, saved;
+	ssize_t n;
+	char path[sizeof(JNL_BOOTFILE) + 16];
+
+	for (tries = 0; J.boot == 0 && tries < 2; tries++) {
+		if ((fd = open(JNL_BOOTFILE, O_RDONLY | O_CLOEXEC)) != -1) {
+			n = read(fd, &J.boot, sizeof(J.boot));
+			(void) close(fd);
+			if (n != sizeof(J.boot)) {
+				warnx("%s: %s is corrupt", __func__,
+				    JNL_BOOTFILE);
+				J.boot = 0;
+			}
+			break;
+		}
+		if (errno != ENOENT) {
+			warn("%s: open(%s)", __func__, JNL_BOOTFILE);
+			break;
+		}
+
+		(void) snprintf(path, sizeof(path), "%s.%d", JNL_BOOTFILE,
+		    getpid());
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		    0600)) == -1) {
+			warn("%s: open(%s)", __func__, path);
+			break;
+		}
+		do {
+			arc4random_buf(&J.boot, sizeof(J.boot));
+		} while (J.boot == 0);
+		n = write(fd, &J.boot, sizeof(J.boot));
+		(void) close(fd);
+		rc = (n == sizeof(J.boot)) ? link(path, JNL_BOOTFILE) : -1;
+		saved = errno;
+		(void) unlink(path);
+		if (rc == 0)
+			break;
+		J.boot = 0;
+		if (saved != EEXIST) {
+			warnc(saved, "%s: link(%s)", __func__, JNL_BOOTFILE);
+			break;
+		}
+		/* lost the race, go read the winner's */
+	}
+	return (J.boot);
+}
+
+static void
+jnl_write(const char *fmt, ...) __printflike(1, 2);
+
+static void
+jnl_write(const char *fmt, ...)
+{
+	int len;
+	char buf[96 + 4 * IFNAMSIZ + MAXHOSTNAMELEN];
+	va_list ap;
+
+	if (J.fd == -1)
+		return;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	assert(len > 0 && (size_t)len < sizeof(buf));
+
+	/* losing a record only costs recovery, never fail the run for it */
+	if (write(J.fd, buf, len) != len)
+		warn("%s: write", __func__);
+}
+
+void
+jnl_intent(const char *jail, int jid, const char *ifhost,
+    const char *ifbridge, const char *ifjail)
+{
+	struct timespec ts;
+
+	if (J.fd == -1)
+		return;
+
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+	(void) snprintf(J.key, sizeof(J.key), "%d.%jx.%lx", getpid(),
+	    (uintmax_t)ts.tv_sec, ts.tv_nsec);
+	jnl_write("I %s %016jx %d %s %s %s %s\n", J.key,
+	    (uintmax_t)boottoken(), jid, ifhost, ifbridge, ifjail, jail);
+}
+
+/*
+ * First step, `epair` (the jail end, which never leaves the jail) exists and
+ * has its final MAC. If we can't tell what it is recovery will leave it be.
+ */
+void
+jnl_create(ifctx ctx, const ifname_t *epair)
+{
+	uint8_t mac[ETHER_ADDR_LEN];
+	char macbuf[LLNAMSIZ];
+	intmax_t epoch;
+
+	assert(epair != NULL);
+	if (J.fd == -1)
+		return;
+
+	if (if_getident(ctx, epair, mac, &epoch) == 0) {
+		jnl_write("S %s create %s %s %jd\n", J.key, epair->name,
+		    mac_format(mac, macbuf), epoch);
+	} else {
+		jnl_write("S %s create %s - -\n", J.key, epair->name);
+	}
+}
+
+/* record step just reached */
+void
+jnl_step(const char *step)
+{
+	assert(step != NULL);
+	jnl_write("S %s %s\n", J.key, step);
+}
+
+void
+jnl_commit(void)
+{
+	jnl_write("C %s\n", J.key);
+}
+
+static struct jnl_entry *
+jnl_find(struct jnl_entry *ent, size_t nent, const char *key)
+{
+	size_t i;
+
+	for (i = nent; i-- > 0; ) {
+		if (strcmp(ent[i].key, key) == 0)
+			return (&ent[i]);
+	}
+	return (NULL);
+}
+
+/*
+ * Destroy whichever of the names of `e`'s jail end in its jail is still that
+ * very interface, which takes the host end with it wherever it is. Returns 0
+ * if it was destroyed, 1 if it is already gone, 2 if the jail couldn't be
+ * attached to (it may have gone since jt_load()) and -1 on failure.
+ */
+static int
+destroy_in_jail(const struct jnl_entry *e)
+{
+	int i, wc, status;
+	intmax_t epoch;
+	uint8_t mac[ETHER_ADDR_LEN];
+	pid_t pid;
+	ifctx ctx;
+	/* renamed to <if-jail> at "rename", but may be killed just before */
+	const ifname_t *names[] = { &e->ifjail, &e->epair };
+
+	switch ((pid = fork())) {
+	case -1:
+		warn("%s: fork", __func__);
+		return (-1);
+	case 0:
+		if (jail_attach(e->jid) == -1)
+			_exit(3);
+		ctx = if_open_ctx(); /* exits on fail */
+		for (i = 0; i < (int)nitems(names); i++) {
+			if (if_nametoindex(names[i]->name) == 0)
+				continue; /* nothing by that name */
+			if (if_getident(ctx, names[i], mac, &epoch) != 0)
+				_exit(2);
+			if (epoch != e->epoch ||
+			    memcmp(mac, e->mac, sizeof(mac)) != 0)
+				continue; /* a later run's, not ours */
+			_exit((if_epair_destroy(ctx, names[i]) == 0) ? 0 : 2);
+		}
+		_exit(1);
+	default:
+		do {
+			wc = waitpid(pid, &status, 0);
+		} while (wc == -1 && errno == EINTR);
+		if (wc == -1 || !WIFEXITED(status))
+			return (-1);
+		switch (WEXITSTATUS(status)) {
+		case 0:
+		case 1:
+			return (WEXITSTATUS(status));
+		case 3:
+			return (2);
+		}
+		return (-1);
+	}
+}
+
+/*
+ * Finish or roll back one uncommitted run. A run that got to "up" did all of
+ * its work and only missed the commit. Otherwise the epair is destroyed from
+ * its jail end, which takes both ends wherever they are, but only if it is
+ * still the interface "create" recorded. Returns -1 only if the epair may
+ * still be there, so the entry has to stay in the journal.
+ */
+static int
+jnl_recover(const struct jnl_entry *e)
+{
+	char jid[16];
+	struct jt_entry *je;
+
+	if (strcmp(e->step, "up") == 0) {
+		warnx("journal: \"%s\" in \"%s\" completed", e->ifhost.name,
+		    e->jail);
+		return (0);
+	}
+	if (e->step[0] == '\0') /* never created anything */
+		return (0);
+
+	/* jail gone (or JID reused) and the epair went with it */
+	(void) snprintf(jid, sizeof(jid), "%d", e->jid);
+	if ((je = jt_lookup(jid)) == NULL || strcmp(je->name, e->jail) != 0)
+		return (0);
+	if (!e->ident) {
+		warnx("journal: \"%s\" in \"%s\" not recorded well enough "
+		    "to roll back", e->ifhost.name, e->jail);
+		return (0);
+	}
+
+	switch (destroy_in_jail(e)) {
+	case 0:
+		warnx("journal: rolled back \"%s\" in \"%s\"", e->ifjail.name,
+		    e->jail);
+		return (0);
+	case 1:
+		return (0); /* gone already */
+	case 2:
+		/*
+		 * The index is from the start of replay, only now is it worth
+		 * asking again. Still there under this JID is a real failure.
+		 */
+		if (jt_revalidate(je) != 0 || je->jid != e->jid)
+			return (0);
+		break;
+	}
+	warnx("journal: unable to roll back \"%s\" in \"%s\"",
+	    e->ifhost.name, e->jail);
+	return (-1);
+}
+
+/*
+ * Caller holds LOCK_EX so everything in the journal is from runs now gone.
+ * The journal is rewritten with just the records of runs that could not be
+ * rolled back, usually that means it is emptied.
+ */
+static int
+jnl_replay_locked(int fd)
+{
+	int n, rc = 0;
+	char *buf, *line, *next, *out, key[JNL_KEYLEN], step[16], arg[IFNAMSIZ];
+	char macbuf[LLNAMSIZ];
+	intmax_t epoch;
+	uint64_t now;
+	struct stat sb;
+	struct jnl_entry *ent = NULL, *e;
+	size_t nent = 0, cap = 0, i;
+	ssize_t len;
+
+	if (fstat(fd, &sb) == -1) {
+		warn("%s: fstat", __func__);
+		return (-1);
+	}
+	if (sb.st_size == 0)
+		return (0);
+
+	/* can't tell this boot's entries from others, so leave them all be */
+	if ((now = boottoken()) == 0) {
+		warnx("%s: no boot token, not replaying", __func__);
+		return (-1);
+	}
+
+	/* a journal is only a few records per run, just read it */
+	if ((buf = malloc(sb.st_size + 1)) == NULL) err(
+		EX_OSERR, "%s: malloc", __func__
+	);
+	if ((len = pread(fd, buf, sb.st_size, 0)) == -1) {
+		warn("%s: pread", __func__);
+		free(buf);
+		return (-1);
+	}
+	buf[len] = '\0';
+
+	for (line = buf; line != NULL && *line != '\0'; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		switch (line[0]) {
+		case 'I':
+			if (nent == cap) {
+				cap = cap ? cap * 2 : 16;
+				if ((e = reallocarray(ent, cap, sizeof(*ent))) ==
+				    NULL) err(
+					EX_OSERR, "%s: reallocarray", __func__
+				);
+				ent = e;
+			}
+			e = &ent[nent];
+			memset(e, 0, sizeof(*e));
+			if (sscanf(line, "I %31s %jx %d %15s %15s %15s %n",
+			    e->key, &e->boot, &e->jid, e->ifhost.name,
+			    e->ifbridge.name, e->ifjail.name, &n) != 6)
+				break; /* torn record */
+			/* another boot's epairs are gone, 0 is an unknown one */
+			e->closed = (e->boot != now);
+			strlcpy(e->jail, line + n, sizeof(e->jail));
+			nent++;
+			break;
+		case 'S':
+			if ((n = sscanf(line, "S %31s %15s %15s %17s %jd", key,
+			    step, arg, macbuf, &epoch)) < 2 ||
+			    (e = jnl_find(ent, nent, key)) == NULL)
+				break;
+			strlcpy(e->step, step, sizeof(e->step));
+			if (strcmp(step, "create") != 0 || n < 3)
+				break;
+			strlcpy(e->epair.name, arg, sizeof(e->epair.name));
+			if (n == 5 && mac_parse(macbuf, e->mac) == 0) {
+				e->epoch = epoch;
+				e->ident = 1;
+			}
+			break;
+		case 'C':
+			if (sscanf(line, "C %31s", key) == 1 &&
+			    (e = jnl_find(ent, nent, key)) != NULL)
+				e->closed = 1;
+			break;
+		}
+	}
+
+	/*
+	 * Enumerate the jails once, entries are then looked up in the index and
+	 * only one whose jail can't be attached to any more costs another
+	 * jail_get(2).
+	 */
+	for (i = 0; i < nent; i++) {
+		if (!ent[i].closed)
+			break;
+	}
+	if (i < nent && jt_load() == -1) {
+		free(buf);
+		free(ent);
+		return (-1);
+	}
+	for (; i < nent; i++) {
+		if (!ent[i].closed && jnl_recover(&ent[i]) == -1) {
+			ent[i].keep = 1;
+			rc = -1;
+		}
+	}
+
+	/* lines are NUL terminated now, pack the ones kept at the front */
+	for (line = out = buf; line < buf + len; line = next) {
+		next = line + strlen(line) + 1;
+		if (sscanf(line, "%*c %31s", key) != 1 ||
+		    (e = jnl_find(ent, nent, key)) == NULL || !e->keep)
+			continue;
+		n = next - line - 1;
+		memmove(out, line, n);
+		out[n] = '\n';
+		out += n + 1;
+	}
+	free(ent);
+
+	if (ftruncate(fd, 0) == -1) {
+		warn("%s: ftruncate", __func__);
+		free(buf);
+		return (-1);
+	}
+	if (out > buf && pwrite(fd, buf, out - buf, 0) != out - buf) {
+		warn("%s: pwrite", __func__);
+		rc = -1;
+	}
+	free(buf);
+	return (rc);
+}
+
+/*
+ * Start journaling this run to `path`. If no other run is using the journal
+ * right now take the opportunity to replay it first. Either way we end up
+ * holding it shared until we exit.
+ */
+void
+jnl_open(const char *path)
+{
+	assert(path != NULL && J.fd == -1);
+
+	if ((J.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+	    0600)) == -1) err(
+		ERREXIT, "%s: open(%s)", __func__, path
+	);
+	if (flock(J.fd, LOCK_EX | LOCK_NB) == 0)
+		(void) jnl_replay_locked(J.fd);
+	if (flock(J.fd, LOCK_SH) == -1) err(
+		ERREXIT, "%s: flock(%s)", __func__, path
+	);
+}
+
+/* replay only, waits for any runs in progress to finish first */
+int
+jnl_replay(const char *path)
+{
+	int fd, rc;
+
+	assert(path != NULL);
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+		warn("%s: open(%s)", __func__, path);
+		return (-1);
+	}
+	if (flock(fd, LOCK_EX) == -1) {
+		warn("%s: flock(%s)", __func__, path);
+		(void) close(fd);
+		return (-1);
+	}
+	rc = jnl_replay_locked(fd);
+	(void) close(fd);
+	return (rc);
+}
@@ -0,0 +1,311 @@
+/*-
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2025 David Marker
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/jail.h>
+#include <sys/uio.h>
+#include <jail.h>
+
+#include "jep.h"
+
+/*
+ * jail_getid(3) followed by jail_getname(3) is two jail_get(2) calls for what
+ * one can answer. That doesn't matter for a single jail, but anything working
+ * through many jails (journal replay in jnl.c) wants to enumerate them once
+ * (`lastjid` iteration) and then look them up by name or JID from an index.
+ *
+ * The index is two open addressing tables of offsets into the entry array,
+ * one hashed by name, one by JID. Lookups always compare the key against the
+ * entry so a slot left behind when an entry is revalidated under a new JID
+ * is just skipped over, no deletion needed.
+ */
+
+#define	JT_EMPTY	(-1)
+
+static struct {
+	struct jt_entry	*ent;
+	size_t		 nent;
+	int		*byname;
+	int		*byjid;
+	size_t		 mask;		/* table size - 1, power of 2 */
+	size_t		 njid;		/* used slots in byjid */
+} JT = {
+	.ent	= NULL,
+	.nent	= 0,
+	.byname	= NULL,
+	.byjid	= NULL,
+	.mask	= 0,
+	.njid	= 0,
+};
+
+/* FNV-1a, names are short and this is plenty */
+static size_t
+hashname(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name != '\0') {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static size_t
+hashjid(int jid)
+{
+	return ((uint32_t)jid * 2654435761U);
+}
+
+/*
+ * Fill `je` from jail_get(2). If `lastjid` is >= 0 that is the key (next jail
+ * after it), otherwise `je->jid` if non-zero, otherwise `je->name`. Returns
+ * the JID or -1 with `jail_errmsg` set just like libjail(3).
+ */
+static int
+jtget(int lastjid, struct jt_entry *je)
+{
+	int jid, vnet = 0;
+	struct iovec iov[12];
+	int niov = 0;
+
+#	define	IOV(n, p, l) do { \
+		iov[niov].iov_base = __DECONST(char *, n); \
+		iov[niov++].iov_len = sizeof(n); \
+		iov[niov].iov_base = (p); \
+		iov[niov++].iov_len = (l); \
+	} while (0)
+
+	if (lastjid >= 0) {
+		IOV("lastjid", &lastjid, sizeof(lastjid));
+		je->jid = 0;
+		je->name[0] = '\0';
+	} else if (je->jid != 0) {
+		je->name[0] = '\0';
+	}
+	IOV("jid", &je->jid, sizeof(je->jid));
+	IOV("name", je->name, sizeof(je->name));
+	IOV("parent", &je->parent, sizeof(je->parent));
+	IOV("vnet", &vnet, sizeof(vnet));
+	jail_errmsg[0] = '\0';
+	IOV("errmsg", jail_errmsg, JAIL_ERRMSGLEN);
+#	undef IOV
+
+	if ((jid = jail_get(iov, niov, 0)) == -1) {
+		if (jail_errmsg[0] == '\0')
+			(void) strlcpy(
+			    jail_errmsg, strerror(errno), JAIL_ERRMSGLEN
+			);
+		return (-1);
+	}
+	je->jid = jid;
+	je->vnet = (vnet == JAIL_SYS_NEW);
+	return (jid);
+}
+
+/* same rules as jail_getid(3): all digits is a JID, anything else a name */
+static int
+keyjid(const char *key)
+{
+	char *end;
+	long jid;
+
+	jid = strtol(key, &end, 10);
+	if (*key == '\0' || *end != '\0' || jid <= 0 || jid > INT_MAX)
+		return (0);
+	return ((int)jid);
+}
+
+/*
+ * Single jail by name or JID in one jail_get(2). This is what a one-off run
+ * wants, no point in enumerating every jail for it.
+ */
+int
+jt_fetch(const char *key, struct jt_entry *je)
+{
+	assert(key != NULL && je != NULL);
+
+	je->jid = keyjid(key);
+	if (je->jid == 0 &&
+	    strlcpy(je->name, key, sizeof(je->name)) >= sizeof(je->name)) {
+		(void) snprintf(
+		    jail_errmsg, JAIL_ERRMSGLEN, "jail \"%s\" name too long", key
+		);
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	return jtget(-1, je);
+}
+
+static void
+jtinsert(int *table, size_t h, int idx)
+{
+	for (h &= JT.mask; table[h] != JT_EMPTY; h = (h + 1) & JT.mask)
+		; /* linear probe */
+	table[h] = idx;
+}
+
+/* (re)build both tables from the entries, drops any stale byjid slots */
+static void
+jtindex(void)
+{
+	size_t i;
+
+	for (i = 0; i <= JT.mask; i++)
+		JT.byname[i] = JT.byjid[i] = JT_EMPTY;
+	for (i = 0; i < JT.nent; i++) {
+		jtinsert(JT.byname, hashname(JT.ent[i].name), i);
+		jtinsert(JT.byjid, hashjid(JT.ent[i].jid), i);
+	}
+	JT.njid = JT.nent;
+}
+
+/* drop the index, jt_lookup() finds nothing until the next jt_load() */
+static void
+jtfree(void)
+{
+	free(JT.ent);
+	free(JT.byname);
+	free(JT.byjid);
+	JT.ent = NULL;
+	JT.byname = JT.byjid = NULL;
+	JT.nent = JT.njid = JT.mask = 0;
+}
+
+/*
+ * Enumerate every jail visible to us once and build the index. Any previous
+ * index is thrown away. Returns the number of jails or -1.
+ */
+int
+jt_load(void)
+{
+	int lastjid = 0;
+	size_t cap = 0, size;
+	struct jt_entry je, *ent;
+
+	jtfree();
+	while (jtget(lastjid, &je) != -1) {
+		if (JT.nent == cap) {
+			cap = cap ? cap * 2 : 64;
+			if ((ent = reallocarray(JT.ent, cap, sizeof(*ent))) ==
+			    NULL) {
+				warn("%s: reallocarray", __func__);
+				jtfree();
+				return (-1);
+			}
+			JT.ent = ent;
+		}
+		JT.ent[JT.nent++] = je;
+		lastjid = je.jid;
+	}
+	/* end of the list is ENOENT, anything else is a real failure */
+	if (errno != ENOENT) {
+		warnx("%s: %s", __func__, jail_errmsg);
+		jtfree();
+		return (-1);
+	}
+
+	/* keep load under 1/2, always at least one empty slot to stop probes */
+	for (size = 16; size < JT.nent * 2; size <<= 1)
+		;
+	JT.mask = size - 1;
+	if ((JT.byname = malloc(size * sizeof(int))) == NULL ||
+	    (JT.byjid = malloc(size * sizeof(int))) == NULL) {
+		warn("%s: malloc", __func__);
+		jtfree();
+		return (-1);
+	}
+	jtindex();
+	return (JT.nent);
+}
+
+/* by name or JID (same rules as jt_fetch) from the index, NULL if not found */
+struct jt_entry *
+jt_lookup(const char *key)
+{
+	int jid, idx;
+	size_t h;
+
+	assert(key != NULL);
+	if (JT.byname == NULL)
+		return (NULL);
+
+	if ((jid = keyjid(key)) != 0) {
+		for (h = hashjid(jid) & JT.mask;
+		     (idx = JT.byjid[h]) != JT_EMPTY; h = (h + 1) & JT.mask) {
+			if (JT.ent[idx].jid == jid)
+				return (&JT.ent[idx]);
+		}
+	} else {
+		for (h = hashname(key) & JT.mask;
+		     (idx = JT.byname[h]) != JT_EMPTY; h = (h + 1) & JT.mask) {
+			if (JT.ent[idx].jid != -1 &&
+			    strcmp(JT.ent[idx].name, key) == 0)
+				return (&JT.ent[idx]);
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * An indexed JID can go stale (jail removed, maybe recreated under the same
+ * name with a new JID). Check just this one jail, by name since that is what
+ * users refer to it by, and fix the entry up. A jail that is gone gets JID -1
+ * so no lookup will return it again. Returns 0 if `je` is (now) valid.
+ */
+int
+jt_revalidate(struct jt_entry *je)
+{
+	struct jt_entry fresh = { .jid = 0 };
+
+	assert(je != NULL);
+	(void) strlcpy(fresh.name, je->name, sizeof(fresh.name));
+	if (jtget(-1, &fresh) == -1) {
+		je->jid = -1;
+		return (-1);
+	}
+	if (fresh.jid == je->jid) {
+		*je = fresh;
+		return (0);
+	}
+	*je = fresh;
+
+	/* new JID needs a slot, stale slots pile up so rebuild when full */
+	if (JT.byjid != NULL && je >= JT.ent && je < JT.ent + JT.nent) {
+		if (++JT.njid * 2 > JT.mask + 1) {
+			jtindex();
+		} else {
+			jtinsert(JT.byjid, hashjid(je->jid), je - JT.ent);
+		}
+	}
+	return (0);
+}
@@ -0,0 +1,239 @@
+/*-
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2025 David Marker
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "jep.h"
+
+/*
+ * Like if.c is a tiny subset of ifconfig(8) this is a tiny subset of route(8).
+ * Only what is needed to give a jail its default route(s) and to watch for
+ * interfaces coming up.
+ */
+
+
+/* route(8) message: header followed by DST, GATEWAY, NETMASK */
+struct rtmsg {
+	struct rt_msghdr	hdr;
+	char			space[3 * sizeof(struct sockaddr_storage)];
+};
+
+static char *
+rtaddsa(char *cp, const struct sockaddr *sa)
+{
+	memcpy(cp, sa, sa->sa_len);
+	return (cp + SA_SIZE(sa));
+}
+
+/*
+ * Family of `gateway` without touching the network so main() can refuse bad
+ * or duplicate -r before anything is created. AF_UNSPEC if neither parses.
+ */
+int
+rt_family(const char *gateway)
+{
+	struct in6_addr a6;
+
+	assert(gateway != NULL);
+	if (inet_pton(AF_INET, gateway, &a6) == 1)
+		return (AF_INET);
+	if (inet_pton(AF_INET6, gateway, &a6) == 1)
+		return (AF_INET6);
+	return (AF_UNSPEC);
+}
+
+/*
+ * Add a default route via `gateway` which may be IPv4 or IPv6 (the family of
+ * the gateway decides which default is added). A link-local IPv6 gateway is
+ * scoped to `ifname`, the interface we just configured.
+ */
+int
+rt_default(const ifname_t *ifname, const char *gateway)
+{
+	int sd, rc = 0;
+	ssize_t len;
+	char *cp;
+	struct rtmsg msg = {
+		.hdr = {
+			.rtm_version = RTM_VERSION,
+			.rtm_type = RTM_ADD,
+			.rtm_flags = RTF_UP | RTF_GATEWAY | RTF_STATIC,
+			.rtm_addrs = RTA_DST | RTA_GATEWAY | RTA_NETMASK,
+			.rtm_seq = 1,
+			.rtm_pid = getpid()
+		}
+	};
+	struct sockaddr_in dst4 = {
+		.sin_len = sizeof(struct sockaddr_in),
+		.sin_family = AF_INET
+	}, gw4 = dst4, mask4 = dst4;
+	struct sockaddr_in6 dst6 = {
+		.sin6_len = sizeof(struct sockaddr_in6),
+		.sin6_family = AF_INET6
+	}, gw6 = dst6, mask6 = dst6;
+
+	assert(ifname != NULL && gateway != NULL);
+
+	cp = msg.space;
+	if (inet_pton(AF_INET, gateway, &gw4.sin_addr) == 1) {
+		cp = rtaddsa(cp, (struct sockaddr *)&dst4);
+		cp = rtaddsa(cp, (struct sockaddr *)&gw4);
+		cp = rtaddsa(cp, (struct sockaddr *)&mask4);
+	} else if (inet_pton(AF_INET6, gateway, &gw6.sin6_addr) == 1) {
+		if (IN6_IS_ADDR_LINKLOCAL(&gw6.sin6_addr) &&
+		    (gw6.sin6_scope_id = if_nametoindex(ifname->name)) == 0) {
+			warn("%s: if_nametoindex(%s)", __func__, ifname->name);
+			return (-1);
+		}
+		cp = rtaddsa(cp, (struct sockaddr *)&dst6);
+		cp = rtaddsa(cp, (struct sockaddr *)&gw6);
+		cp = rtaddsa(cp, (struct sockaddr *)&mask6);
+	} else {
+		warnc(EINVAL, "gateway=\"%s\" invalid", gateway);
+		errno = EINVAL;
+		return (-1);
+	}
+	msg.hdr.rtm_msglen = len = cp - (char *)&msg;
+
+	if ((sd = socket(PF_ROUTE, SOCK_RAW, 0)) == -1) {
+		warn("%s: socket(PF_ROUTE, SOCK_RAW, 0)", __func__);
+		return (-1);
+	}
+	/* kernel rejects the write itself on failure, no need to read reply */
+	if (write(sd, &msg, len) != len) {
+		warn("%s: write(RTM_ADD %s)", __func__, gateway);
+		rc = -1;
+	}
+	(void) close(sd);
+	return (rc);
+}
+
+/*
+ * Routing socket for link state changes. Open it before bringing anything up
+ * so no RTM_IFINFO can slip by between checking and waiting.
+ */
+int
+rt_watch(void)
+{
+	int sd;
+	unsigned int filter = ROUTE_FILTER(RTM_IFINFO);
+
+	if ((sd = socket(PF_ROUTE, SOCK_RAW, 0)) == -1) {
+		warn("%s: socket(PF_ROUTE, SOCK_RAW, 0)", __func__);
+		return (-1);
+	}
+	/* only an optimization, without it we just read more to skip */
+	(void) setsockopt(sd, PF_ROUTE, ROUTE_MSGFILTER, &filter,
+	    sizeof(filter));
+	return (sd);
+}
+
+/* monotonic ms, what rt_wait_ready() measures from */
+int64_t
+rt_msnow(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*
+ * Block until `ifname` is up and running with link and forwarding on
+ * `brname`, or until `timeout` ms after `start` (rt_msnow() taken before
+ * bringing it up). Nothing is checked again until an RTM_IFINFO for `ifname`
+ * arrives on `rs` from rt_watch(). The one exception is a port
+ * with STP enabled that is still listening/learning, bridge(4) sends no
+ * message for port state so only then is it polled every RT_POLL_MS. Returns
+ * ms since `start` or -1 (errno ETIMEDOUT if it just never was ready).
+ */
+#define	RT_POLL_MS	50
+
+int
+rt_wait_ready(int rs, ifctx ctx, const ifname_t *ifname,
+    const ifname_t *brname, int64_t start, int timeout)
+{
+	int rc = 0, check = 1, stp = 0;
+	unsigned int idx;
+	int64_t left;
+	ssize_t len;
+	union {
+		struct if_msghdr	ifm;
+		char			buf[2048];
+	} msg;
+	struct pollfd pfd = {
+		.fd = rs,
+		.events = POLLIN
+	};
+
+	assert(rs >= 0 && ifname != NULL && brname != NULL && timeout >= 0);
+
+	if ((idx = if_nametoindex(ifname->name)) == 0) {
+		warn("%s: if_nametoindex(%s)", __func__, ifname->name);
+		return (-1);
+	}
+	for (;;) {
+		if (check) {
+			stp = 0;
+			if ((rc = if_running(ctx, ifname)) == 1)
+				stp = ((rc = if_forwarding(
+				    ctx, ifname, brname)) == 0);
+			if (rc == 1)
+				return ((int)(rt_msnow() - start));
+			if (rc == -1)
+				return (-1);
+		}
+
+		if ((left = timeout - (rt_msnow() - start)) <= 0) {
+			errno = ETIMEDOUT;
+			return (-1);
+		}
+		if (poll(&pfd, 1, stp ? MIN(left, RT_POLL_MS) : left) == -1 &&
+		    errno != EINTR) {
+			warn("%s: poll", __func__);
+			return (-1);
+		}
+		/* only a change to `ifname` (or the STP poll) is worth a look */
+		check = stp;
+		while ((len = recv(rs, &msg, sizeof(msg), MSG_DONTWAIT)) > 0) {
+			if ((size_t)len >= sizeof(msg.ifm) &&
+			    msg.ifm.ifm_version == RTM_VERSION &&
+			    msg.ifm.ifm_type == RTM_IFINFO &&
+			    msg.ifm.ifm_index == idx)
+				check = 1;
+		}
+	}
+}
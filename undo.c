@@ -0,0 +1,180 @@
+/*-
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2025 David Marker
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jep.h"
+
+/*
+ * Every step that changes an interface records how to take it back. On any
+ * failure the log is unwound newest first, so whatever state we got to is
+ * walked back in the order it was built.
+ *
+ * Everything logged is a change to the one epair, so if its creation is in
+ * the log (the jail side) destroying it undoes the rest in a single ioctl and
+ * the other entries are skipped. That only works if the destroy knows the
+ * current name, which is why renames go through undo_rename().
+ *
+ * The log is sized up front by undo_init() so recording a step can't fail
+ * after the step itself has succeeded.
+ */
+
+struct undo {
+	enum undo_op	op;
+	ifname_t	ifname;
+	ifname_t	arg;		/* interface or group name */
+};
+
+static struct {
+	struct undo	*log;
+	size_t		 len;
+	size_t		 cap;
+} U = {
+	.log	= NULL,
+	.len	= 0,
+	.cap	= 0,
+};
+
+void
+undo_init(size_t cap)
+{
+	assert(U.log == NULL);
+	if ((U.log = calloc(cap, sizeof(*U.log))) == NULL) err(
+		EX_OSERR, "%s: calloc", __func__
+	);
+	U.cap = cap;
+}
+
+void
+undo_push(enum undo_op op, const ifname_t *ifname, const char *arg)
+{
+	struct undo *u;
+
+	assert(ifname != NULL);
+	assert(U.len < U.cap); /* undo_init() was told too few */
+
+	u = &U.log[U.len++];
+	u->op = op;
+	u->ifname = *ifname;
+	strlcpy(u->arg.name, (arg != NULL) ? arg : "", sizeof(u->arg.name));
+}
+
+/* log rename `from` -> `to` and keep any pending destroy pointed at it */
+void
+undo_rename(const ifname_t *from, const ifname_t *to)
+{
+	size_t i;
+
+	assert(from != NULL && to != NULL);
+	for (i = 0; i < U.len; i++) {
+		if (U.log[i].op == UNDO_DESTROY &&
+		    strcmp(U.log[i].ifname.name, from->name) == 0)
+			U.log[i].ifname = *to;
+	}
+	undo_push(UNDO_RENAME, to, from->name);
+}
+
+static int
+undo_one(ifctx ctx, const struct undo *u)
+{
+	switch (u->op) {
+	case UNDO_DESTROY:
+		return if_epair_destroy(ctx, &u->ifname);
+	case UNDO_RENAME:
+		return if_rename(ctx, &u->ifname, &u->arg);
+	case UNDO_DELGROUP:
+		return if_delgroup(ctx, &u->ifname, u->arg.name);
+	case UNDO_DOWN:
+		return if_down(ctx, &u->ifname);
+	case UNDO_DELM:
+		return if_delm(ctx, &u->ifname, &u->arg);
+	}
+	return (-1);
+}
+
+static const char *opname[] = {
+	[UNDO_DESTROY]	= "destroy",
+	[UNDO_RENAME]	= "rename",
+	[UNDO_DELGROUP]	= "delgroup",
+	[UNDO_DOWN]	= "down",
+	[UNDO_DELM]	= "deletem",
+};
+
+static int
+undo_run(ifctx ctx, const struct undo *u)
+{
+	if (undo_one(ctx, u) == 0)
+		return (0);
+	warnx("undo: %s \"%s\" failed", opname[u->op], u->ifname.name);
+	return (-1);
+}
+
+/*
+ * If the epair can be destroyed that is the whole rollback. Otherwise run the
+ * log newest to oldest, keep going past failures since every step still
+ * undone is something left behind. Reports what happened on stderr and
+ * returns the number of actions that failed. The log is empty afterwards.
+ */
+int
+undo_unwind(ifctx ctx)
+{
+	size_t i, done = 0, failed = 0;
+
+	for (i = 0; i < U.len; i++) {
+		if (U.log[i].op != UNDO_DESTROY)
+			continue;
+		if (undo_run(ctx, &U.log[i]) == 0) {
+			warnx("rolled back %zu step(s) by destroying \"%s\"",
+			    U.len, U.log[i].ifname.name);
+			U.len = 0;
+			return (0);
+		}
+		failed++; /* and fall back to doing it the long way */
+	}
+
+	for (i = U.len; i-- > 0; ) {
+		if (U.log[i].op == UNDO_DESTROY)
+			continue; /* already failed above */
+		if (undo_run(ctx, &U.log[i]) == 0)
+			done++;
+		else
+			failed++;
+	}
+
+	if (U.len) warnx(
+		"rolled back %zu of %zu step(s)", done, U.len
+	);
+	U.len = 0;
+	return (failed);
+}
+
+/* everything succeeded, nothing to undo */
+void
+undo_clear(void)
+{
+	U.len = 0;
+}